@@ -5,12 +5,175 @@
 #include "controlled_random.hpp"
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <iterator>
+#include <limits>
+#include <atomic>
+#include <iostream>
 
 
 // you do not need the cpp file. this library is header only.
 // this file just contains test code
 
 
+// splits num_chunks chunks of work evenly between num_threads threads. when a
+// thread runs out of its own chunks it steals chunks from the other threads,
+// so a slow thread doesn't hold up the others. calls
+// process_chunk(thread_index, chunk_index) exactly once for every chunk
+template<typename ProcessChunk>
+void run_work_stealing(size_t num_chunks, unsigned num_threads, ProcessChunk && process_chunk)
+{
+    // one cache line per queue so that threads don't fight over them
+    struct alignas(64) WorkQueue
+    {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+    std::vector<WorkQueue> queues(num_threads);
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        queues[i].next = num_chunks * i / num_threads;
+        queues[i].end = num_chunks * (i + 1) / num_threads;
+    }
+    std::vector<std::thread> threads;
+    for (unsigned thread_number = 0; thread_number < num_threads; ++thread_number)
+    {
+        threads.emplace_back([&queues, &process_chunk, thread_number, num_threads]
+        {
+            for (unsigned offset = 0; offset < num_threads; ++offset)
+            {
+                WorkQueue & queue = queues[(thread_number + offset) % num_threads];
+                for (;;)
+                {
+                    size_t chunk = queue.next.fetch_add(1, std::memory_order_relaxed);
+                    if (chunk >= queue.end)
+                        break;
+                    process_chunk(thread_number, chunk);
+                }
+            }
+        });
+    }
+    for (std::thread & thread : threads)
+        thread.join();
+}
+
+struct SimulatedEntity
+{
+    SimulatedEntity()
+        : rollers{ ska::ControlledRandom(0.05f), ska::ControlledRandom(0.2f), ska::ControlledRandom(0.5f), ska::ControlledRandom(0.8f) }
+        , loot{ 1.0f, 2.0f, 3.0f, 4.0f }
+    {
+    }
+
+    ska::ControlledRandom rollers[4];
+    // inline storage so that creating millions of these doesn't allocate
+    ska::BasicWeightedDistribution<4, std::allocator<std::byte>> loot;
+};
+
+struct alignas(64) SimulationThreadState
+{
+    std::mt19937_64 randomness;
+    size_t num_rolls = 0;
+    size_t num_picks = 0;
+    size_t checksum = 0;
+};
+
+struct SimulationCounts
+{
+    // calls to ControlledRandom::random_success
+    size_t num_rolls = 0;
+    // calls to WeightedDistribution::pick_random
+    size_t num_picks = 0;
+    size_t checksum = 0;
+};
+
+// runs num_rounds rounds of all rollers and a loot pick for every success on
+// every entity. entities are processed in chunks that fit in the L2 cache and
+// all rounds of a chunk run before moving on to the next chunk
+SimulationCounts simulate_entities(std::vector<SimulatedEntity> & entities, unsigned num_threads, int num_rounds)
+{
+    constexpr size_t chunk_bytes = 256 * 1024;
+    size_t entities_per_chunk = std::max(chunk_bytes / sizeof(SimulatedEntity), size_t(1));
+    size_t num_chunks = (entities.size() + entities_per_chunk - 1) / entities_per_chunk;
+    std::vector<SimulationThreadState> thread_states(num_threads);
+    for (unsigned i = 0; i < num_threads; ++i)
+        thread_states[i].randomness.seed(i + 1);
+    run_work_stealing(num_chunks, num_threads, [&](unsigned thread_number, size_t chunk)
+    {
+        SimulationThreadState & state = thread_states[thread_number];
+        auto begin = entities.begin() + chunk * entities_per_chunk;
+        auto end = entities.begin() + std::min((chunk + 1) * entities_per_chunk, entities.size());
+        for (int round = 0; round < num_rounds; ++round)
+        {
+            for (auto it = begin; it != end; ++it)
+            {
+                for (ska::ControlledRandom & roller : it->rollers)
+                {
+                    ++state.num_rolls;
+                    if (roller.random_success(state.randomness))
+                    {
+                        ++state.num_picks;
+                        state.checksum += it->loot.pick_random(state.randomness);
+                    }
+                }
+            }
+        }
+    });
+    SimulationCounts counts;
+    for (const SimulationThreadState & state : thread_states)
+    {
+        counts.num_rolls += state.num_rolls;
+        counts.num_picks += state.num_picks;
+        counts.checksum += state.checksum;
+    }
+    return counts;
+}
+
+// simulates lots of entities with one to 64 threads and prints how well that
+// scales. use this to catch scaling regressions in the library. operations
+// are rolls and picks together, and the efficiency is based on those. the
+// bandwidth isn't measured, it's estimated from how much entity state was
+// read and written, which is a lower bound on the actual memory traffic
+void benchmark_simulation_scaling()
+{
+    constexpr size_t num_entities = 10000000;
+    constexpr int num_rounds = 4;
+    std::vector<SimulatedEntity> entities(num_entities);
+    // initialize with the same threads that will use the entities later
+    unsigned max_threads = 64;
+    std::vector<std::mt19937_64> init_randomness(max_threads);
+    run_work_stealing(max_threads, max_threads, [&](unsigned thread_number, size_t chunk)
+    {
+        std::mt19937_64 & randomness = init_randomness[thread_number];
+        randomness.seed(chunk + 1);
+        for (size_t i = num_entities * chunk / max_threads, end = num_entities * (chunk + 1) / max_threads; i < end; ++i)
+            entities[i].loot.initialize_randomness(randomness);
+    });
+
+    std::cout << num_entities << " entities, " << sizeof(SimulatedEntity) << " bytes each, "
+              << std::thread::hardware_concurrency() << " hardware threads\n";
+    double single_thread_operations_per_second = 0.0;
+    for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+        auto before = std::chrono::high_resolution_clock::now();
+        SimulationCounts counts = simulate_entities(entities, num_threads, num_rounds);
+        std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - before;
+        double rolls_per_second = counts.num_rolls / seconds.count();
+        double picks_per_second = counts.num_picks / seconds.count();
+        double operations_per_second = rolls_per_second + picks_per_second;
+        if (num_threads == 1)
+            single_thread_operations_per_second = operations_per_second;
+        double efficiency = operations_per_second / (single_thread_operations_per_second * num_threads);
+        double estimated_gigabytes_per_second = 2.0 * num_entities * sizeof(SimulatedEntity) / seconds.count() / 1e9;
+        std::cout << num_threads << " threads: " << rolls_per_second / 1e6 << " million rolls/s, "
+                  << picks_per_second / 1e6 << " million picks/s, "
+                  << operations_per_second / 1e6 << " million operations/s, "
+                  << efficiency * 100.0 << "% efficiency, "
+                  << estimated_gigabytes_per_second << " GB/s estimated entity state bandwidth"
+                  << " (checksum " << counts.checksum << ')' << std::endl;
+    }
+}
+
 #ifdef ENABLE_GTEST
 #include "gtest/gtest.h"
 
@@ -213,6 +376,388 @@ TEST(controlled_random, multiple_choices_large_numbers)
     ASSERT_GE(4100, num_picks[3]);
 }
 
+TEST(controlled_random, multiple_choices_partial_jitter)
+{
+    std::mt19937_64 randomness(5);
+    ska::JitteredWeightedDistribution<75> distribution = { 1.0f, 2.0f, 3.0f, 4.0f };
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(distribution.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++num_picks[distribution.pick_random(randomness)];
+    }
+    ASSERT_LE(900, num_picks[0]);
+    ASSERT_GE(1100, num_picks[0]);
+    ASSERT_LE(1900, num_picks[1]);
+    ASSERT_GE(2100, num_picks[1]);
+    ASSERT_LE(2900, num_picks[2]);
+    ASSERT_GE(3100, num_picks[2]);
+    ASSERT_LE(3900, num_picks[3]);
+    ASSERT_GE(4100, num_picks[3]);
+}
+
+TEST(controlled_random, multiple_choices_no_jitter)
+{
+    std::mt19937_64 randomness(5);
+    ska::JitteredWeightedDistribution<0> distribution = { 1.0f, 2.0f, 3.0f, 4.0f };
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(distribution.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++num_picks[distribution.pick_random(randomness)];
+    }
+    ASSERT_LE(990, num_picks[0]);
+    ASSERT_GE(1010, num_picks[0]);
+    ASSERT_LE(1990, num_picks[1]);
+    ASSERT_GE(2010, num_picks[1]);
+    ASSERT_LE(2990, num_picks[2]);
+    ASSERT_GE(3010, num_picks[2]);
+    ASSERT_LE(3990, num_picks[3]);
+    ASSERT_GE(4010, num_picks[3]);
+
+    // with no jitter two equal weights have to alternate
+    ska::JitteredWeightedDistribution<0> alternating = { 1.0f, 1.0f };
+    alternating.initialize_randomness(randomness);
+    size_t previous = alternating.pick_random(randomness);
+    for (int i = 0; i < 100; ++i)
+    {
+        size_t next = alternating.pick_random(randomness);
+        ASSERT_NE(previous, next);
+        previous = next;
+    }
+}
+
+TEST(controlled_random, inline_weights)
+{
+    std::mt19937_64 randomness(5);
+    // the null_memory_resource throws on every allocation, so this only
+    // works if the weights are stored inline
+    ska::pmr::WeightedDistribution<4> distribution({ 1.0f, 2.0f, 3.0f, 4.0f }, std::pmr::null_memory_resource());
+    distribution.initialize_randomness(randomness);
+    ska::pmr::WeightedDistribution<4> copy(distribution);
+    ska::pmr::WeightedDistribution<4> moved(std::move(distribution));
+    ASSERT_EQ(0u, distribution.num_weights());
+    ASSERT_EQ(4u, copy.num_weights());
+    ASSERT_EQ(4u, moved.num_weights());
+    std::mt19937_64 copy_randomness = randomness;
+    std::vector<size_t> num_picks(moved.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        size_t picked = moved.pick_random(randomness);
+        ASSERT_EQ(picked, copy.pick_random(copy_randomness));
+        ++num_picks[picked];
+    }
+    ASSERT_LE(900, num_picks[0]);
+    ASSERT_GE(1100, num_picks[0]);
+    ASSERT_LE(1900, num_picks[1]);
+    ASSERT_GE(2100, num_picks[1]);
+    ASSERT_LE(2900, num_picks[2]);
+    ASSERT_GE(3100, num_picks[2]);
+    ASSERT_LE(3900, num_picks[3]);
+    ASSERT_GE(4100, num_picks[3]);
+}
+
+TEST(controlled_random, allocator_weights)
+{
+    std::mt19937_64 randomness(5);
+    unsigned char buffer[1024];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    ska::pmr::WeightedDistribution<2> distribution({ 1.0f, 2.0f, 3.0f, 4.0f }, &arena);
+    distribution.initialize_randomness(randomness);
+    ska::pmr::WeightedDistribution<2> same_arena(&arena);
+    same_arena = std::move(distribution);
+    ASSERT_EQ(0u, distribution.num_weights());
+    ASSERT_EQ(4u, same_arena.num_weights());
+    // different memory resources, so this has to copy
+    ska::pmr::WeightedDistribution<2> other_arena;
+    other_arena = std::move(same_arena);
+    ASSERT_EQ(4u, other_arena.num_weights());
+    ASSERT_EQ(std::pmr::get_default_resource(), other_arena.get_allocator().resource());
+    std::vector<size_t> num_picks(other_arena.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++num_picks[other_arena.pick_random(randomness)];
+    }
+    ASSERT_LE(900, num_picks[0]);
+    ASSERT_GE(1100, num_picks[0]);
+    ASSERT_LE(1900, num_picks[1]);
+    ASSERT_GE(2100, num_picks[1]);
+    ASSERT_LE(2900, num_picks[2]);
+    ASSERT_GE(3100, num_picks[2]);
+    ASSERT_LE(3900, num_picks[3]);
+    ASSERT_GE(4100, num_picks[3]);
+}
+
+TEST(controlled_random, hierarchical_choices)
+{
+    std::mt19937_64 randomness(5);
+    ska::HierarchicalWeightedDistribution<> distribution;
+    distribution.add_tier(1.0f, { 1.0f, 1.0f });
+    distribution.add_tier(3.0f, { 1.0f, 2.0f });
+    ASSERT_EQ(2u, distribution.num_tiers());
+    ASSERT_EQ(2u, distribution.num_items(0));
+    ASSERT_EQ(2u, distribution.num_items(1));
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(4);
+    for (int i = 0; i < 10000; ++i)
+    {
+        ska::HierarchicalWeightedDistribution<>::Pick pick = distribution.pick_random(randomness);
+        ++num_picks[pick.tier * 2 + pick.item];
+    }
+    ASSERT_LE(1150, num_picks[0]);
+    ASSERT_GE(1350, num_picks[0]);
+    ASSERT_LE(1150, num_picks[1]);
+    ASSERT_GE(1350, num_picks[1]);
+    ASSERT_LE(2400, num_picks[2]);
+    ASSERT_GE(2600, num_picks[2]);
+    ASSERT_LE(4900, num_picks[3]);
+    ASSERT_GE(5100, num_picks[3]);
+}
+
+TEST(controlled_random, event_scheduler)
+{
+    std::mt19937_64 randomness(5);
+    ska::EventScheduler<> scheduler;
+    scheduler.add_event(30000);
+    scheduler.add_event(10000);
+    scheduler.initialize_randomness(randomness);
+    std::vector<size_t> fired;
+    // nothing can be due right away
+    scheduler.poll(randomness, 0, std::back_inserter(fired));
+    ASSERT_TRUE(fired.empty());
+    std::vector<size_t> num_fired(scheduler.num_events());
+    std::vector<uint32_t> last_fired(scheduler.num_events(), 0);
+    uint32_t now = 0;
+    for (int i = 0; i < 625000; ++i)
+    {
+        now += 16;
+        fired.clear();
+        scheduler.poll(randomness, 16, std::back_inserter(fired));
+        for (size_t event : fired)
+        {
+            // never fires again before half the average time. the poll
+            // interval adds some inaccuracy
+            uint32_t min_time = (event == 0 ? 15000u : 5000u) - 16u;
+            if (num_fired[event])
+            {
+                ASSERT_LE(min_time, now - last_fired[event]);
+            }
+            ++num_fired[event];
+            last_fired[event] = now;
+        }
+    }
+    // ten million time units in total
+    ASSERT_LE(323, num_fired[0]);
+    ASSERT_GE(343, num_fired[0]);
+    ASSERT_LE(990, num_fired[1]);
+    ASSERT_GE(1010, num_fired[1]);
+}
+
+TEST(controlled_random, event_scheduler_wraparound)
+{
+    std::mt19937_64 randomness(5);
+    ska::EventScheduler<> scheduler;
+    scheduler.add_event(1 << 20);
+    scheduler.add_event(ska::EventScheduler<>::max_average_time);
+    scheduler.initialize_randomness(randomness);
+    std::vector<size_t> fired;
+    // sixteen times around the timeline, half of it in steps that are bigger
+    // than what the scheduler can handle in one step
+    for (int i = 0; i < 16; ++i)
+        scheduler.poll(randomness, std::numeric_limits<uint32_t>::max(), std::back_inserter(fired));
+    for (int i = 0; i < 64; ++i)
+        scheduler.poll(randomness, 1u << 30, std::back_inserter(fired));
+    size_t num_frequent = std::count(fired.begin(), fired.end(), size_t(0));
+    size_t num_rare = fired.size() - num_frequent;
+    // 2^37 time units in total
+    ASSERT_LE(130000u, num_frequent);
+    ASSERT_GE(132000u, num_frequent);
+    ASSERT_LE(116u, num_rare);
+    ASSERT_GE(140u, num_rare);
+    ASSERT_LE(1u, scheduler.time_until_next_event());
+}
+
+struct NestedLootTable
+{
+    ska::WeightedDistribution tiers;
+    std::vector<ska::WeightedDistribution> items;
+};
+
+TEST(controlled_random, DISABLED_benchmark_hierarchical_distribution)
+{
+    constexpr size_t num_tables = 4096;
+    constexpr int num_picks = 10000000;
+    const float tier_weights[] = { 50.0f, 25.0f, 15.0f, 8.0f, 2.0f };
+    std::vector<float> item_weights;
+    for (int i = 1; i <= 16; ++i)
+        item_weights.push_back(static_cast<float>(i));
+
+    std::mt19937_64 randomness(5);
+    std::vector<NestedLootTable> nested(num_tables);
+    std::vector<ska::HierarchicalWeightedDistribution<>> flat(num_tables);
+    for (size_t i = 0; i < num_tables; ++i)
+    {
+        for (float tier_weight : tier_weights)
+        {
+            nested[i].tiers.add_weight(tier_weight);
+            nested[i].items.emplace_back();
+            for (float w : item_weights)
+                nested[i].items.back().add_weight(w);
+            nested[i].items.back().initialize_randomness(randomness);
+            flat[i].add_tier(tier_weight, item_weights.begin(), item_weights.end());
+        }
+        nested[i].tiers.initialize_randomness(randomness);
+        flat[i].initialize_randomness(randomness);
+    }
+    std::vector<size_t> table_order(num_picks);
+    for (size_t & index : table_order)
+        index = std::uniform_int_distribution<size_t>(0, num_tables - 1)(randomness);
+
+    size_t checksum = 0;
+    auto before = std::chrono::high_resolution_clock::now();
+    for (size_t table : table_order)
+    {
+        NestedLootTable & loot = nested[table];
+        size_t tier = loot.tiers.pick_random(randomness);
+        checksum += loot.items[tier].pick_random(randomness);
+    }
+    auto after_nested = std::chrono::high_resolution_clock::now();
+    for (size_t table : table_order)
+    {
+        ska::HierarchicalWeightedDistribution<>::Pick pick = flat[table].pick_random(randomness);
+        checksum += pick.item;
+    }
+    auto after_flat = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> nested_time = after_nested - before;
+    std::chrono::duration<double, std::nano> flat_time = after_flat - after_nested;
+    std::cout << "nested: " << nested_time.count() / num_picks << " ns per pick\n";
+    std::cout << "hierarchical: " << flat_time.count() / num_picks << " ns per pick\n";
+    std::cout << "(checksum " << checksum << ')' << std::endl;
+}
+
+TEST(controlled_random, work_stealing)
+{
+    for (unsigned num_threads : { 1u, 3u, 8u })
+    {
+        std::vector<std::atomic<int>> num_visits(1000);
+        run_work_stealing(num_visits.size(), num_threads, [&](unsigned thread_number, size_t chunk)
+        {
+            ASSERT_GT(num_threads, thread_number);
+            ++num_visits[chunk];
+        });
+        for (const std::atomic<int> & visits : num_visits)
+            ASSERT_EQ(1, visits.load());
+    }
+}
+
+TEST(controlled_random, DISABLED_benchmark_simulation_scaling)
+{
+    benchmark_simulation_scaling();
+}
+
+TEST(controlled_random, pick_distinct)
+{
+    std::mt19937_64 randomness(5);
+    ska::WeightedDistribution distribution = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f };
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(distribution.num_weights());
+    std::vector<size_t> picked;
+    for (int i = 0; i < 10000; ++i)
+    {
+        picked.clear();
+        distribution.pick_distinct(randomness, 3, std::back_inserter(picked));
+        ASSERT_EQ(3u, picked.size());
+        ASSERT_NE(picked[0], picked[1]);
+        ASSERT_NE(picked[0], picked[2]);
+        ASSERT_NE(picked[1], picked[2]);
+        for (size_t index : picked)
+            ++num_picks[index];
+    }
+    // 30000 picks in total, so each weight is worth 30000 / 36 picks
+    for (size_t i = 0; i < num_picks.size(); ++i)
+    {
+        float expected = (i + 1) * 30000.0f / 36.0f;
+        ASSERT_LE(expected * 0.95f, static_cast<float>(num_picks[i]));
+        ASSERT_GE(expected * 1.05f, static_cast<float>(num_picks[i]));
+    }
+    // one weight is more than half of the total, so it has to show up in
+    // every round. the other two share the remaining slot
+    ska::WeightedDistribution saturated = { 100.0f, 1.0f, 1.0f };
+    saturated.initialize_randomness(randomness);
+    std::fill(num_picks.begin(), num_picks.begin() + 3, 0);
+    for (int i = 0; i < 100000; ++i)
+    {
+        picked.clear();
+        saturated.pick_distinct(randomness, 2, std::back_inserter(picked));
+        for (size_t index : picked)
+            ++num_picks[index];
+    }
+    ASSERT_EQ(100000u, num_picks[0]);
+    ASSERT_LE(48500u, num_picks[1]);
+    ASSERT_GE(51500u, num_picks[1]);
+    ASSERT_LE(48500u, num_picks[2]);
+    ASSERT_GE(51500u, num_picks[2]);
+
+    ska::WeightedDistribution barely_saturated = { 3.0f, 1.0f, 1.0f };
+    barely_saturated.initialize_randomness(randomness);
+    std::fill(num_picks.begin(), num_picks.begin() + 3, 0);
+    for (int i = 0; i < 200000; ++i)
+    {
+        picked.clear();
+        barely_saturated.pick_distinct(randomness, 2, std::back_inserter(picked));
+        for (size_t index : picked)
+            ++num_picks[index];
+    }
+    ASSERT_LE(196000u, num_picks[0]);
+    ASSERT_LE(num_picks[1] * 97 / 100, num_picks[2]);
+    ASSERT_GE(num_picks[1] * 103 / 100, num_picks[2]);
+}
+
+TEST(controlled_random, DISABLED_benchmark_pick_distinct)
+{
+    constexpr int num_rounds = 100000;
+    std::mt19937_64 randomness(5);
+    ska::WeightedDistribution distribution;
+    for (int i = 1; i <= 64; ++i)
+        distribution.add_weight(static_cast<float>(i));
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> picked;
+    std::vector<bool> already_picked(distribution.num_weights());
+    size_t checksum = 0;
+    for (size_t k : { 3, 4, 8, 16, 32 })
+    {
+        auto before = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_rounds; ++i)
+        {
+            picked.clear();
+            distribution.pick_distinct(randomness, k, std::back_inserter(picked));
+            checksum += picked.back();
+        }
+        auto after_distinct = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_rounds; ++i)
+        {
+            picked.clear();
+            while (picked.size() < k)
+            {
+                size_t index = distribution.pick_random(randomness);
+                if (already_picked[index])
+                    continue;
+                already_picked[index] = true;
+                picked.push_back(index);
+            }
+            for (size_t index : picked)
+                already_picked[index] = false;
+            checksum += picked.back();
+        }
+        auto after_reject = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::nano> distinct_time = after_distinct - before;
+        std::chrono::duration<double, std::nano> reject_time = after_reject - after_distinct;
+        std::cout << "k = " << k << ": pick_distinct " << distinct_time.count() / num_rounds << " ns per round, "
+                  << "pick_random with rejection " << reject_time.count() / num_rounds << " ns per round\n";
+    }
+    std::cout << "(checksum " << checksum << ')' << std::endl;
+}
+
 template<typename Randomness>
 size_t pick_true_random(const std::vector<float> & weights, Randomness & randomness)
 {
@@ -480,6 +1025,382 @@ void test_multiple_choices_large_numbers()
 
 
 
+void test_multiple_choices_partial_jitter()
+{
+    std::mt19937_64 randomness(5);
+    ska::JitteredWeightedDistribution<75> distribution = { 1.0f, 2.0f, 3.0f, 4.0f };
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(distribution.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++num_picks[distribution.pick_random(randomness)];
+    }
+    assert(900 <= num_picks[0]);
+    assert(1100 >= num_picks[0]);
+    assert(1900 <= num_picks[1]);
+    assert(2100 >= num_picks[1]);
+    assert(2900 <= num_picks[2]);
+    assert(3100 >= num_picks[2]);
+    assert(3900 <= num_picks[3]);
+    assert(4100 >= num_picks[3]);
+}
+
+void test_multiple_choices_no_jitter()
+{
+    std::mt19937_64 randomness(5);
+    ska::JitteredWeightedDistribution<0> distribution = { 1.0f, 2.0f, 3.0f, 4.0f };
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(distribution.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++num_picks[distribution.pick_random(randomness)];
+    }
+    assert(990 <= num_picks[0]);
+    assert(1010 >= num_picks[0]);
+    assert(1990 <= num_picks[1]);
+    assert(2010 >= num_picks[1]);
+    assert(2990 <= num_picks[2]);
+    assert(3010 >= num_picks[2]);
+    assert(3990 <= num_picks[3]);
+    assert(4010 >= num_picks[3]);
+
+    // with no jitter two equal weights have to alternate
+    ska::JitteredWeightedDistribution<0> alternating = { 1.0f, 1.0f };
+    alternating.initialize_randomness(randomness);
+    size_t previous = alternating.pick_random(randomness);
+    for (int i = 0; i < 100; ++i)
+    {
+        size_t next = alternating.pick_random(randomness);
+        assert(previous != next);
+        previous = next;
+    }
+}
+
+void test_inline_weights()
+{
+    std::mt19937_64 randomness(5);
+    // the null_memory_resource throws on every allocation, so this only
+    // works if the weights are stored inline
+    ska::pmr::WeightedDistribution<4> distribution({ 1.0f, 2.0f, 3.0f, 4.0f }, std::pmr::null_memory_resource());
+    distribution.initialize_randomness(randomness);
+    ska::pmr::WeightedDistribution<4> copy(distribution);
+    ska::pmr::WeightedDistribution<4> moved(std::move(distribution));
+    assert(0u == distribution.num_weights());
+    assert(4u == copy.num_weights());
+    assert(4u == moved.num_weights());
+    std::mt19937_64 copy_randomness = randomness;
+    std::vector<size_t> num_picks(moved.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        size_t picked = moved.pick_random(randomness);
+        size_t copy_picked = copy.pick_random(copy_randomness);
+        assert(picked == copy_picked);
+        ++num_picks[picked];
+    }
+    assert(900 <= num_picks[0]);
+    assert(1100 >= num_picks[0]);
+    assert(1900 <= num_picks[1]);
+    assert(2100 >= num_picks[1]);
+    assert(2900 <= num_picks[2]);
+    assert(3100 >= num_picks[2]);
+    assert(3900 <= num_picks[3]);
+    assert(4100 >= num_picks[3]);
+}
+
+void test_allocator_weights()
+{
+    std::mt19937_64 randomness(5);
+    unsigned char buffer[1024];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    ska::pmr::WeightedDistribution<2> distribution({ 1.0f, 2.0f, 3.0f, 4.0f }, &arena);
+    distribution.initialize_randomness(randomness);
+    ska::pmr::WeightedDistribution<2> same_arena(&arena);
+    same_arena = std::move(distribution);
+    assert(0u == distribution.num_weights());
+    assert(4u == same_arena.num_weights());
+    // different memory resources, so this has to copy
+    ska::pmr::WeightedDistribution<2> other_arena;
+    other_arena = std::move(same_arena);
+    assert(4u == other_arena.num_weights());
+    assert(std::pmr::get_default_resource() == other_arena.get_allocator().resource());
+    std::vector<size_t> num_picks(other_arena.num_weights());
+    for (int i = 0; i < 10000; ++i)
+    {
+        ++num_picks[other_arena.pick_random(randomness)];
+    }
+    assert(900 <= num_picks[0]);
+    assert(1100 >= num_picks[0]);
+    assert(1900 <= num_picks[1]);
+    assert(2100 >= num_picks[1]);
+    assert(2900 <= num_picks[2]);
+    assert(3100 >= num_picks[2]);
+    assert(3900 <= num_picks[3]);
+    assert(4100 >= num_picks[3]);
+}
+
+void test_hierarchical_choices()
+{
+    std::mt19937_64 randomness(5);
+    ska::HierarchicalWeightedDistribution<> distribution;
+    distribution.add_tier(1.0f, { 1.0f, 1.0f });
+    distribution.add_tier(3.0f, { 1.0f, 2.0f });
+    assert(2u == distribution.num_tiers());
+    assert(2u == distribution.num_items(0));
+    assert(2u == distribution.num_items(1));
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(4);
+    for (int i = 0; i < 10000; ++i)
+    {
+        ska::HierarchicalWeightedDistribution<>::Pick pick = distribution.pick_random(randomness);
+        ++num_picks[pick.tier * 2 + pick.item];
+    }
+    assert(1150 <= num_picks[0]);
+    assert(1350 >= num_picks[0]);
+    assert(1150 <= num_picks[1]);
+    assert(1350 >= num_picks[1]);
+    assert(2400 <= num_picks[2]);
+    assert(2600 >= num_picks[2]);
+    assert(4900 <= num_picks[3]);
+    assert(5100 >= num_picks[3]);
+}
+
+void test_event_scheduler()
+{
+    std::mt19937_64 randomness(5);
+    ska::EventScheduler<> scheduler;
+    scheduler.add_event(30000);
+    scheduler.add_event(10000);
+    scheduler.initialize_randomness(randomness);
+    std::vector<size_t> fired;
+    // nothing can be due right away
+    scheduler.poll(randomness, 0, std::back_inserter(fired));
+    assert(fired.empty());
+    std::vector<size_t> num_fired(scheduler.num_events());
+    std::vector<uint32_t> last_fired(scheduler.num_events(), 0);
+    uint32_t now = 0;
+    for (int i = 0; i < 625000; ++i)
+    {
+        now += 16;
+        fired.clear();
+        scheduler.poll(randomness, 16, std::back_inserter(fired));
+        for (size_t event : fired)
+        {
+            // never fires again before half the average time. the poll
+            // interval adds some inaccuracy
+            uint32_t min_time = (event == 0 ? 15000u : 5000u) - 16u;
+            if (num_fired[event])
+                assert(min_time <= now - last_fired[event]);
+            ++num_fired[event];
+            last_fired[event] = now;
+        }
+    }
+    // ten million time units in total
+    assert(323 <= num_fired[0]);
+    assert(343 >= num_fired[0]);
+    assert(990 <= num_fired[1]);
+    assert(1010 >= num_fired[1]);
+}
+
+void test_event_scheduler_wraparound()
+{
+    std::mt19937_64 randomness(5);
+    ska::EventScheduler<> scheduler;
+    scheduler.add_event(1 << 20);
+    scheduler.add_event(ska::EventScheduler<>::max_average_time);
+    scheduler.initialize_randomness(randomness);
+    std::vector<size_t> fired;
+    // sixteen times around the timeline, half of it in steps that are bigger
+    // than what the scheduler can handle in one step
+    for (int i = 0; i < 16; ++i)
+        scheduler.poll(randomness, std::numeric_limits<uint32_t>::max(), std::back_inserter(fired));
+    for (int i = 0; i < 64; ++i)
+        scheduler.poll(randomness, 1u << 30, std::back_inserter(fired));
+    size_t num_frequent = std::count(fired.begin(), fired.end(), size_t(0));
+    size_t num_rare = fired.size() - num_frequent;
+    // 2^37 time units in total
+    assert(130000u <= num_frequent);
+    assert(132000u >= num_frequent);
+    assert(116u <= num_rare);
+    assert(140u >= num_rare);
+    assert(1u <= scheduler.time_until_next_event());
+}
+
+struct NestedLootTable
+{
+    ska::WeightedDistribution tiers;
+    std::vector<ska::WeightedDistribution> items;
+};
+
+void benchmark_hierarchical_distribution()
+{
+    constexpr size_t num_tables = 4096;
+    constexpr int num_picks = 10000000;
+    const float tier_weights[] = { 50.0f, 25.0f, 15.0f, 8.0f, 2.0f };
+    std::vector<float> item_weights;
+    for (int i = 1; i <= 16; ++i)
+        item_weights.push_back(static_cast<float>(i));
+
+    std::mt19937_64 randomness(5);
+    std::vector<NestedLootTable> nested(num_tables);
+    std::vector<ska::HierarchicalWeightedDistribution<>> flat(num_tables);
+    for (size_t i = 0; i < num_tables; ++i)
+    {
+        for (float tier_weight : tier_weights)
+        {
+            nested[i].tiers.add_weight(tier_weight);
+            nested[i].items.emplace_back();
+            for (float w : item_weights)
+                nested[i].items.back().add_weight(w);
+            nested[i].items.back().initialize_randomness(randomness);
+            flat[i].add_tier(tier_weight, item_weights.begin(), item_weights.end());
+        }
+        nested[i].tiers.initialize_randomness(randomness);
+        flat[i].initialize_randomness(randomness);
+    }
+    std::vector<size_t> table_order(num_picks);
+    for (size_t & index : table_order)
+        index = std::uniform_int_distribution<size_t>(0, num_tables - 1)(randomness);
+
+    size_t checksum = 0;
+    auto before = std::chrono::high_resolution_clock::now();
+    for (size_t table : table_order)
+    {
+        NestedLootTable & loot = nested[table];
+        size_t tier = loot.tiers.pick_random(randomness);
+        checksum += loot.items[tier].pick_random(randomness);
+    }
+    auto after_nested = std::chrono::high_resolution_clock::now();
+    for (size_t table : table_order)
+    {
+        ska::HierarchicalWeightedDistribution<>::Pick pick = flat[table].pick_random(randomness);
+        checksum += pick.item;
+    }
+    auto after_flat = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> nested_time = after_nested - before;
+    std::chrono::duration<double, std::nano> flat_time = after_flat - after_nested;
+    std::cout << "nested: " << nested_time.count() / num_picks << " ns per pick\n";
+    std::cout << "hierarchical: " << flat_time.count() / num_picks << " ns per pick\n";
+    std::cout << "(checksum " << checksum << ')' << std::endl;
+}
+
+void test_work_stealing()
+{
+    for (unsigned num_threads : { 1u, 3u, 8u })
+    {
+        std::vector<std::atomic<int>> num_visits(1000);
+        run_work_stealing(num_visits.size(), num_threads, [&](unsigned thread_number, size_t chunk)
+        {
+            assert(num_threads > thread_number);
+            ++num_visits[chunk];
+        });
+        for (const std::atomic<int> & visits : num_visits)
+            assert(1 == visits.load());
+    }
+}
+
+void test_pick_distinct()
+{
+    std::mt19937_64 randomness(5);
+    ska::WeightedDistribution distribution = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f };
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> num_picks(distribution.num_weights());
+    std::vector<size_t> picked;
+    for (int i = 0; i < 10000; ++i)
+    {
+        picked.clear();
+        distribution.pick_distinct(randomness, 3, std::back_inserter(picked));
+        assert(3u == picked.size());
+        assert(picked[0] != picked[1]);
+        assert(picked[0] != picked[2]);
+        assert(picked[1] != picked[2]);
+        for (size_t index : picked)
+            ++num_picks[index];
+    }
+    // 30000 picks in total, so each weight is worth 30000 / 36 picks
+    for (size_t i = 0; i < num_picks.size(); ++i)
+    {
+        float expected = (i + 1) * 30000.0f / 36.0f;
+        assert(expected * 0.95f <= static_cast<float>(num_picks[i]));
+        assert(expected * 1.05f >= static_cast<float>(num_picks[i]));
+    }
+    // one weight is more than half of the total, so it has to show up in
+    // every round. the other two share the remaining slot
+    ska::WeightedDistribution saturated = { 100.0f, 1.0f, 1.0f };
+    saturated.initialize_randomness(randomness);
+    std::fill(num_picks.begin(), num_picks.begin() + 3, 0);
+    for (int i = 0; i < 100000; ++i)
+    {
+        picked.clear();
+        saturated.pick_distinct(randomness, 2, std::back_inserter(picked));
+        for (size_t index : picked)
+            ++num_picks[index];
+    }
+    assert(100000u == num_picks[0]);
+    assert(48500u <= num_picks[1]);
+    assert(51500u >= num_picks[1]);
+    assert(48500u <= num_picks[2]);
+    assert(51500u >= num_picks[2]);
+
+    ska::WeightedDistribution barely_saturated = { 3.0f, 1.0f, 1.0f };
+    barely_saturated.initialize_randomness(randomness);
+    std::fill(num_picks.begin(), num_picks.begin() + 3, 0);
+    for (int i = 0; i < 200000; ++i)
+    {
+        picked.clear();
+        barely_saturated.pick_distinct(randomness, 2, std::back_inserter(picked));
+        for (size_t index : picked)
+            ++num_picks[index];
+    }
+    assert(196000u <= num_picks[0]);
+    assert(num_picks[1] * 97 / 100 <= num_picks[2]);
+    assert(num_picks[1] * 103 / 100 >= num_picks[2]);
+}
+
+void benchmark_pick_distinct()
+{
+    constexpr int num_rounds = 100000;
+    std::mt19937_64 randomness(5);
+    ska::WeightedDistribution distribution;
+    for (int i = 1; i <= 64; ++i)
+        distribution.add_weight(static_cast<float>(i));
+    distribution.initialize_randomness(randomness);
+    std::vector<size_t> picked;
+    std::vector<bool> already_picked(distribution.num_weights());
+    size_t checksum = 0;
+    for (size_t k : { 3, 4, 8, 16, 32 })
+    {
+        auto before = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_rounds; ++i)
+        {
+            picked.clear();
+            distribution.pick_distinct(randomness, k, std::back_inserter(picked));
+            checksum += picked.back();
+        }
+        auto after_distinct = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_rounds; ++i)
+        {
+            picked.clear();
+            while (picked.size() < k)
+            {
+                size_t index = distribution.pick_random(randomness);
+                if (already_picked[index])
+                    continue;
+                already_picked[index] = true;
+                picked.push_back(index);
+            }
+            for (size_t index : picked)
+                already_picked[index] = false;
+            checksum += picked.back();
+        }
+        auto after_reject = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::nano> distinct_time = after_distinct - before;
+        std::chrono::duration<double, std::nano> reject_time = after_reject - after_distinct;
+        std::cout << "k = " << k << ": pick_distinct " << distinct_time.count() / num_rounds << " ns per round, "
+                  << "pick_random with rejection " << reject_time.count() / num_rounds << " ns per round\n";
+    }
+    std::cout << "(checksum " << checksum << ')' << std::endl;
+}
+
 template<typename Randomness>
 size_t pick_true_random(const std::vector<float> & weights, Randomness & randomness)
 {
@@ -546,6 +1467,18 @@ int main()
     test_multiple_choices();
     test_multiple_choices_small_numbers();
     test_multiple_choices_large_numbers();
+    test_multiple_choices_partial_jitter();
+    test_multiple_choices_no_jitter();
+    test_inline_weights();
+    test_allocator_weights();
+    test_hierarchical_choices();
+    test_event_scheduler();
+    test_event_scheduler_wraparound();
+    //benchmark_hierarchical_distribution();
+    test_work_stealing();
+    //benchmark_simulation_scaling();
+    test_pick_distinct();
+    //benchmark_pick_distinct();
     plot_wait_times();
 }
 
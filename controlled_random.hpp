@@ -8,6 +8,9 @@
 #include <random>
 #include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
 
 namespace ska
 {
@@ -24,6 +27,38 @@ inline uint32_t round_positive_float(float f)
     return static_cast<uint32_t>(f + 0.5f);
 }
 
+// returns how far to move an event forward on the timeline after it fired.
+// JitterPercent controls how much of that is random: 100 means the delay is
+// uniformly picked from [0, average_time_between_events], 0 means it's always
+// exactly average_time_between_events. values in between blend the two, so
+// 75 means the delay is picked from [average_time_between_events / 4,
+// average_time_between_events]. the blend is a template parameter so that
+// every choice compiles down to just the arithmetic that it needs, and with
+// no jitter the random number generator doesn't get called at all.
+//
+// note that less jitter also means that the average delay gets longer. that
+// doesn't change the distribution as long as all items on the same timeline
+// use the same JitterPercent, because then all delays grow by the same factor
+template<uint32_t JitterPercent, typename Random>
+uint32_t random_time_until_next_event(uint32_t average_time_between_events, Random & randomness)
+{
+    static_assert(JitterPercent <= 100, "JitterPercent has to be in the range [0, 100]");
+    if constexpr (JitterPercent == 0)
+    {
+        static_cast<void>(randomness);
+        return average_time_between_events;
+    }
+    else if constexpr (JitterPercent == 100)
+    {
+        return std::uniform_int_distribution<uint32_t>(0, average_time_between_events)(randomness);
+    }
+    else
+    {
+        uint32_t jitter = static_cast<uint32_t>(static_cast<uint64_t>(average_time_between_events) * JitterPercent / 100);
+        return average_time_between_events - jitter + std::uniform_int_distribution<uint32_t>(0, jitter)(randomness);
+    }
+}
+
 template<typename It, typename Compare>
 void heap_top_updated(It begin, It end, Compare && compare)
 {
@@ -49,7 +84,63 @@ void heap_top_updated(It begin, It end)
     return heap_top_updated(begin, end, std::less<>());
 }
 
-class WeightedDistribution
+// compares events on a timeline that wraps around by how far after the
+// reference point they happen. sorts later events first, so that the heap
+// functions put the next event at the top of the heap. works for any type
+// with a uint32_t next_event_time
+template<typename Event>
+struct CompareByNextTime
+{
+    uint32_t reference_point = 0;
+    bool operator()(const Event & l, const Event & r) const
+    {
+        return (l.next_event_time - reference_point) > (r.next_event_time - reference_point);
+    }
+};
+
+// storage for the small buffer in BasicWeightedDistribution. is empty if the
+// capacity is zero, so use it as a base class to make it take no space
+template<typename T, size_t Capacity>
+struct InlineBuffer
+{
+    alignas(T) unsigned char bytes[sizeof(T) * Capacity];
+
+    T * inline_data()
+    {
+        return reinterpret_cast<T *>(bytes);
+    }
+    const T * inline_data() const
+    {
+        return reinterpret_cast<const T *>(bytes);
+    }
+};
+template<typename T>
+struct InlineBuffer<T, 0>
+{
+    T * inline_data()
+    {
+        return nullptr;
+    }
+    const T * inline_data() const
+    {
+        return nullptr;
+    }
+};
+
+// the weights are stored in memory from the Allocator, except if there are
+// at most InlineCapacity of them. then they're stored inside the object and
+// there is no allocation at all. so if you create lots of short lived
+// distributions, pick an InlineCapacity that fits most of them. this works
+// with any allocator, including std::pmr::polymorphic_allocator. (see the
+// ska::pmr::WeightedDistribution alias below) copying is a memcpy, moving
+// just takes the pointer unless the weights are stored inline.
+//
+// JitterPercent controls how random the spacing between picks is. see
+// random_time_until_next_event for details. for example use 75 to blend in
+// 25% determinism, or 0 to get evenly spaced picks that never call the random
+// number generator.
+template<size_t InlineCapacity = 0, typename Allocator = std::allocator<std::byte>, uint32_t JitterPercent = 100>
+class BasicWeightedDistribution
 {
     static constexpr float fixed_point_multiplier = 1024.0f * 1024.0f;
     struct Weight
@@ -65,30 +156,183 @@ class WeightedDistribution
         uint32_t average_time_between_events;
         size_t original_index;
     };
-    struct CompareByNextTime
+    static_assert(std::is_trivially_copyable<Weight>::value, "copying weights has to be a memcpy");
+    using CompareByNextTime = ska::CompareByNextTime<Weight>;
+
+    using WeightAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Weight>;
+    using AllocatorTraits = std::allocator_traits<WeightAllocator>;
+
+    // inherits from the allocator and the inline buffer so that they take no
+    // space if they're empty
+    struct Storage : WeightAllocator, InlineBuffer<Weight, InlineCapacity>
     {
-        uint32_t reference_point = 0;
-        bool operator()(const Weight & l, const Weight & r) const
+        explicit Storage(const WeightAllocator & allocator)
+            : WeightAllocator(allocator)
         {
-            return (l.next_event_time - reference_point) > (r.next_event_time - reference_point);
         }
+
+        Weight * data = nullptr;
+        size_t size = 0;
+        size_t capacity = 0;
     };
 
-    std::vector<Weight> weights;
+    Storage weights;
+
+    WeightAllocator & allocator()
+    {
+        return weights;
+    }
+    const WeightAllocator & allocator() const
+    {
+        return weights;
+    }
+    Weight * begin()
+    {
+        return weights.data;
+    }
+    Weight * end()
+    {
+        return weights.data + weights.size;
+    }
+
+    bool is_inline() const
+    {
+        return weights.data == weights.inline_data();
+    }
+    void reset_to_inline()
+    {
+        if (!is_inline())
+            AllocatorTraits::deallocate(allocator(), weights.data, weights.capacity);
+        weights.data = weights.inline_data();
+        weights.size = 0;
+        weights.capacity = InlineCapacity;
+    }
+    void grow(size_t new_capacity)
+    {
+        Weight * new_data = AllocatorTraits::allocate(allocator(), new_capacity);
+        std::uninitialized_copy(weights.data, weights.data + weights.size, new_data);
+        size_t size = weights.size;
+        reset_to_inline();
+        weights.data = new_data;
+        weights.size = size;
+        weights.capacity = new_capacity;
+    }
+    void assign(const Weight * begin, const Weight * end)
+    {
+        size_t size = end - begin;
+        if (size > weights.capacity)
+        {
+            reset_to_inline();
+            weights.data = AllocatorTraits::allocate(allocator(), size);
+            weights.capacity = size;
+        }
+        std::uninitialized_copy(begin, end, weights.data);
+        weights.size = size;
+    }
+    // requires that this is empty and uses the inline buffer and that other
+    // uses an allocator that we can deallocate with
+    void steal_from(BasicWeightedDistribution & other)
+    {
+        if (other.is_inline())
+        {
+            std::uninitialized_copy(other.begin(), other.end(), weights.data);
+            weights.size = other.weights.size;
+        }
+        else
+        {
+            weights.data = other.weights.data;
+            weights.size = other.weights.size;
+            weights.capacity = other.weights.capacity;
+            other.weights.data = other.weights.inline_data();
+            other.weights.capacity = InlineCapacity;
+        }
+        other.weights.size = 0;
+    }
 
 public:
 
-    WeightedDistribution()
+    using allocator_type = Allocator;
+
+    BasicWeightedDistribution()
+        : BasicWeightedDistribution(Allocator())
+    {
+    }
+    explicit BasicWeightedDistribution(const Allocator & allocator)
+        : weights(WeightAllocator(allocator))
     {
+        weights.data = weights.inline_data();
+        weights.capacity = InlineCapacity;
     }
 
-    WeightedDistribution(std::initializer_list<float> il)
+    BasicWeightedDistribution(std::initializer_list<float> il, const Allocator & allocator = Allocator())
+        : BasicWeightedDistribution(allocator)
     {
-        weights.reserve(il.size());
+        reserve(il.size());
         for (float w : il)
             add_weight(w);
     }
 
+    BasicWeightedDistribution(const BasicWeightedDistribution & other)
+        : weights(AllocatorTraits::select_on_container_copy_construction(other.allocator()))
+    {
+        weights.data = weights.inline_data();
+        weights.capacity = InlineCapacity;
+        assign(other.weights.data, other.weights.data + other.weights.size);
+    }
+    BasicWeightedDistribution(BasicWeightedDistribution && other) noexcept
+        : weights(other.allocator())
+    {
+        weights.data = weights.inline_data();
+        weights.capacity = InlineCapacity;
+        steal_from(other);
+    }
+    BasicWeightedDistribution & operator=(const BasicWeightedDistribution & other)
+    {
+        if (this == &other)
+            return *this;
+        if constexpr (AllocatorTraits::propagate_on_container_copy_assignment::value)
+        {
+            if (allocator() != other.allocator())
+            {
+                reset_to_inline();
+                allocator() = other.allocator();
+            }
+        }
+        assign(other.weights.data, other.weights.data + other.weights.size);
+        return *this;
+    }
+    BasicWeightedDistribution & operator=(BasicWeightedDistribution && other) noexcept(AllocatorTraits::propagate_on_container_move_assignment::value || AllocatorTraits::is_always_equal::value)
+    {
+        if (this == &other)
+            return *this;
+        if constexpr (AllocatorTraits::propagate_on_container_move_assignment::value)
+        {
+            reset_to_inline();
+            allocator() = std::move(other.allocator());
+            steal_from(other);
+        }
+        else if (allocator() == other.allocator())
+        {
+            reset_to_inline();
+            steal_from(other);
+        }
+        else
+        {
+            // can't take memory from a different allocator, have to copy
+            assign(other.weights.data, other.weights.data + other.weights.size);
+        }
+        return *this;
+    }
+    ~BasicWeightedDistribution()
+    {
+        reset_to_inline();
+    }
+
+    allocator_type get_allocator() const
+    {
+        return allocator_type(allocator());
+    }
+
     // how these values were chosen:
     // min_weight was chosen so that the largest number we add in pick_random
     // can be std::numeric_limits<uint32_t>::max() / 4. that gives us enough
@@ -117,17 +361,26 @@ public:
     static constexpr float min_weight = 1.0f / 1024.0f;
     static constexpr float max_weight = 10240.0f;
 
+    void reserve(size_t capacity)
+    {
+        if (capacity > weights.capacity)
+            grow(capacity);
+    }
+
     void add_weight(float w)
     {
         // since I'm using fixed point math, I only support a certain range
         assert(w >= min_weight);
         assert(w <= max_weight);
-        weights.emplace_back(1.0f / w, weights.size());
+        if (weights.size == weights.capacity)
+            grow(std::max(weights.capacity * 2, size_t(4)));
+        ::new (static_cast<void *>(end())) Weight(1.0f / w, weights.size);
+        ++weights.size;
     }
 
     size_t num_weights() const
     {
-        return weights.size();
+        return weights.size;
     }
 
     // you need to call this once after adding all the weights to this
@@ -136,11 +389,11 @@ public:
     template<typename Random>
     void initialize_randomness(Random & randomness)
     {
-        for (Weight & w : weights)
+        for (Weight * w = begin(); w != end(); ++w)
         {
-            w.next_event_time = std::uniform_int_distribution<uint32_t>(0, w.average_time_between_events)(randomness);
+            w->next_event_time = std::uniform_int_distribution<uint32_t>(0, w->average_time_between_events)(randomness);
         }
-        std::make_heap(weights.begin(), weights.end(), CompareByNextTime{0});
+        std::make_heap(begin(), end(), CompareByNextTime{0});
     }
 
     // use this to pick a random item. it will give the distribution that you
@@ -149,20 +402,82 @@ public:
     template<typename Random>
     size_t pick_random(Random & randomness)
     {
-        Weight & picked = weights.front();
+        Weight & picked = *begin();
         size_t result = picked.original_index;
         uint32_t reference_point = picked.next_event_time;
-        uint32_t to_add = std::uniform_int_distribution<uint32_t>(0, picked.average_time_between_events)(randomness);
-        // uncomment these three lines to blend in 25% determinism
-        //to_add *= 3;
-        //to_add /= 4;
-        //to_add += picked.average_time_between_events / 4;
-        picked.next_event_time += to_add;
-        heap_top_updated(weights.begin(), weights.end(), CompareByNextTime{reference_point});
+        picked.next_event_time += random_time_until_next_event<JitterPercent>(picked.average_time_between_events, randomness);
+        heap_top_updated(begin(), end(), CompareByNextTime{reference_point});
         return result;
     }
+
+    // picks k different items at once, for example for drawing a hand of
+    // cards or for the offers in a shop. writes the indices of the items into
+    // out in the order in which they were picked. this is the same as taking
+    // the next k items that pick_random would give you, except skipping
+    // repeats. over many rounds each item shows up as often as its weight
+    // asks for, except if an item's weight is so big that it would have to
+    // show up more than once per round. then it shows up in nearly every
+    // round. this exists to get distinct items with the right frequencies,
+    // not for speed: for small k it's a bit slower than calling pick_random
+    // and throwing away repeats.
+    template<typename Random, typename OutputIt>
+    OutputIt pick_distinct(Random & randomness, size_t k, OutputIt out)
+    {
+        assert(k <= weights.size);
+        if (k == 0)
+            return out;
+        // all items are scheduled after the first one, so it works as the
+        // reference point for all of them
+        CompareByNextTime compare{begin()->next_event_time};
+        Weight * heap_end = end();
+        for (size_t i = 0; i < k; ++i)
+        {
+            std::pop_heap(begin(), heap_end, compare);
+            --heap_end;
+            *out = heap_end->original_index;
+            ++out;
+        }
+        // the last item picked decides the time of this round. an item that
+        // gets picked every round because of its big weight would otherwise
+        // fall further and further behind all other items, until the times
+        // wrap around and the heap gets ordered wrong. so nothing that was
+        // picked may stay more than its own average time behind the round.
+        // that keeps all items within one max delay of the top, like in
+        // pick_random. moving everything all the way up to the round time
+        // would instead make items that were picked early in a round show
+        // up less often than their weight asks for
+        uint32_t round_time = heap_end->next_event_time;
+        for (Weight * picked = heap_end; picked != end(); ++picked)
+        {
+            uint32_t behind = round_time - picked->next_event_time;
+            if (behind > picked->average_time_between_events)
+                picked->next_event_time = round_time - picked->average_time_between_events;
+            picked->next_event_time += random_time_until_next_event<JitterPercent>(picked->average_time_between_events, randomness);
+            // the picked items were just rescheduled so they're usually far
+            // in the future. that makes push_heap stop after a step or two
+            std::push_heap(begin(), picked + 1, compare);
+        }
+        return out;
+    }
 };
 
+using WeightedDistribution = BasicWeightedDistribution<>;
+
+// for picking the blend of a table without having to spell out the storage.
+// for example JitteredWeightedDistribution<0> for evenly spaced picks
+template<uint32_t JitterPercent, size_t InlineCapacity = 0>
+using JitteredWeightedDistribution = BasicWeightedDistribution<InlineCapacity, std::allocator<std::byte>, JitterPercent>;
+
+namespace pmr
+{
+template<size_t InlineCapacity = 0, uint32_t JitterPercent = 100>
+using WeightedDistribution = BasicWeightedDistribution<InlineCapacity, std::pmr::polymorphic_allocator<std::byte>, JitterPercent>;
+}
+
+// without inline storage this should be as small as a std::vector
+static_assert(sizeof(WeightedDistribution) == 3 * sizeof(void *), "the empty buffer and allocator should take no space");
+static_assert(sizeof(pmr::WeightedDistribution<>) == 3 * sizeof(void *) + sizeof(std::pmr::polymorphic_allocator<std::byte>), "the empty buffer should take no space");
+
 // this is a version of the above for when you just have two choicse:
 // just success and fail. so a single chance value is enough and you
 // don't need weights. it's a bit slow though. I wouldn't use it as is.
@@ -239,5 +554,307 @@ public:
     }
 };
 
+// this is for when your choices are nested, like when you first pick a rarity
+// tier and then pick an item within that tier. you could do that with one
+// WeightedDistribution for the tiers and one WeightedDistribution per tier,
+// but then every pick has to jump between separate heap allocations. this
+// class gives the same results (each level separately tries to not repeat
+// itself too often) but stores everything in one array of twelve byte slots:
+// first the heap of tiers, then where the items of each tier are, then the
+// heap of items for each tier in order. so a pick touches the top of the
+// tier heap, the range right after it, and the top of one packed item heap.
+// JitterPercent works the same as in BasicWeightedDistribution and applies
+// to both levels.
+template<uint32_t JitterPercent = 100>
+class HierarchicalWeightedDistribution
+{
+    static constexpr float fixed_point_multiplier = 1024.0f * 1024.0f;
+    struct Node
+    {
+        Node(float frequency, size_t original_index)
+            : average_time_between_events(round_positive_float(frequency * fixed_point_multiplier))
+            , original_index(static_cast<uint32_t>(original_index))
+        {
+            next_event_time = average_time_between_events;
+        }
+
+        uint32_t next_event_time;
+        uint32_t average_time_between_events;
+        uint32_t original_index;
+    };
+    struct ItemRange
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+    // slots [0, num_tiers) are the heap of tiers and are Nodes. slots
+    // [num_tiers, 2 * num_tiers) are the ItemRange of each tier, by tier
+    // index. everything after that are the item Nodes
+    union Slot
+    {
+        Slot(const Node & node)
+            : node(node)
+        {
+        }
+        Slot(const ItemRange & range)
+            : range(range)
+        {
+        }
+
+        Node node;
+        ItemRange range;
+    };
+    static_assert(sizeof(Slot) == 12, "item heaps should be tightly packed");
+    struct CompareByNextTime
+    {
+        ska::CompareByNextTime<Node> compare_nodes;
+        bool operator()(const Slot & l, const Slot & r) const
+        {
+            return compare_nodes(l.node, r.node);
+        }
+    };
+
+    std::vector<Slot> slots;
+    uint32_t num_tiers_ = 0;
+
+    static Node make_node(float w, size_t original_index)
+    {
+        // same limits as in WeightedDistribution. see the comment there
+        assert(w >= WeightedDistribution::min_weight);
+        assert(w <= WeightedDistribution::max_weight);
+        return Node(1.0f / w, original_index);
+    }
+
+    const ItemRange & item_range(size_t tier) const
+    {
+        return slots[num_tiers_ + tier].range;
+    }
+
+public:
+
+    struct Pick
+    {
+        size_t tier;
+        // the index of the item within the tier
+        size_t item;
+    };
+
+    HierarchicalWeightedDistribution()
+    {
+    }
+
+    // adds a tier with the given weight. the item weights decide how likely
+    // each item is to be picked once this tier was picked. returns the index
+    // of the tier. adding a tier has to move all items to make space for it
+    // so build this once and then keep using it.
+    template<typename It>
+    size_t add_tier(float tier_weight, It items_begin, It items_end)
+    {
+        assert(items_begin != items_end);
+        size_t tier_index = num_tiers_;
+        // make space for one more tier and one more range
+        slots.insert(slots.begin() + 2 * num_tiers_, ItemRange{ 0, 0 });
+        slots.insert(slots.begin() + num_tiers_, make_node(tier_weight, tier_index));
+        ++num_tiers_;
+        for (size_t i = 0; i < tier_index; ++i)
+        {
+            ItemRange & range = slots[num_tiers_ + i].range;
+            range.begin += 2;
+            range.end += 2;
+        }
+        uint32_t begin = static_cast<uint32_t>(slots.size());
+        size_t item_index = 0;
+        for (; items_begin != items_end; ++items_begin)
+            slots.push_back(make_node(*items_begin, item_index++));
+        slots[num_tiers_ + tier_index].range = ItemRange{ begin, static_cast<uint32_t>(slots.size()) };
+        return tier_index;
+    }
+    size_t add_tier(float tier_weight, std::initializer_list<float> item_weights)
+    {
+        return add_tier(tier_weight, item_weights.begin(), item_weights.end());
+    }
+
+    size_t num_tiers() const
+    {
+        return num_tiers_;
+    }
+    size_t num_items(size_t tier) const
+    {
+        const ItemRange & range = item_range(tier);
+        return range.end - range.begin;
+    }
+
+    // you need to call this once after adding all the tiers. same as in
+    // WeightedDistribution
+    template<typename Random>
+    void initialize_randomness(Random & randomness)
+    {
+        auto randomize = [&randomness](Slot & slot)
+        {
+            slot.node.next_event_time = std::uniform_int_distribution<uint32_t>(0, slot.node.average_time_between_events)(randomness);
+        };
+        auto tiers_begin = slots.begin();
+        auto tiers_end = slots.begin() + num_tiers_;
+        std::for_each(tiers_begin, tiers_end, randomize);
+        std::make_heap(tiers_begin, tiers_end, CompareByNextTime{{0}});
+        for (size_t i = 0; i < num_tiers_; ++i)
+        {
+            ItemRange range = item_range(i);
+            std::for_each(slots.begin() + range.begin, slots.begin() + range.end, randomize);
+            std::make_heap(slots.begin() + range.begin, slots.begin() + range.end, CompareByNextTime{{0}});
+        }
+    }
+
+    // picks a tier and then an item within that tier. works like
+    // WeightedDistribution::pick_random on both levels
+    template<typename Random>
+    Pick pick_random(Random & randomness)
+    {
+        Node & tier = slots.front().node;
+        ItemRange range = item_range(tier.original_index);
+        auto items_begin = slots.begin() + range.begin;
+        auto items_end = slots.begin() + range.end;
+        Node & item = items_begin->node;
+        Pick result = { tier.original_index, item.original_index };
+
+        uint32_t reference_point = item.next_event_time;
+        item.next_event_time += random_time_until_next_event<JitterPercent>(item.average_time_between_events, randomness);
+        heap_top_updated(items_begin, items_end, CompareByNextTime{{reference_point}});
+
+        reference_point = tier.next_event_time;
+        tier.next_event_time += random_time_until_next_event<JitterPercent>(tier.average_time_between_events, randomness);
+        heap_top_updated(slots.begin(), slots.begin() + num_tiers_, CompareByNextTime{{reference_point}});
+        return result;
+    }
+};
+
+// WeightedDistribution thinks of every item as an event that happens
+// periodically with some jitter, and always picks the event that happens next.
+// this uses the same timeline for events in real time: add events with their
+// average time between events, then tell the scheduler how much time has
+// passed and it gives you every event that fired in that time. time is in
+// whatever unit you want, for example milliseconds. the timeline wraps around
+// after 2^32 units, which is fine as long as a single event has an average
+// time of at most max_average_time.
+//
+// with the default JitterPercent of 100 the time between two firings of an
+// event is picked from [average / 2, average * 3 / 2] so an event never fires
+// twice in quick succession. 0 makes events perfectly periodic. unlike in
+// WeightedDistribution, the average stays the same for all JitterPercent.
+template<uint32_t JitterPercent = 100>
+class EventScheduler
+{
+    static_assert(JitterPercent <= 100, "JitterPercent has to be in the range [0, 100]");
+    struct Event
+    {
+        uint32_t next_event_time;
+        uint32_t average_time_between_events;
+        size_t original_index;
+    };
+    using CompareByNextTime = ska::CompareByNextTime<Event>;
+
+    std::vector<Event> events;
+    uint32_t current_time = 0;
+
+    template<typename Random>
+    static uint32_t centered_time_until_next_event(uint32_t average_time_between_events, Random & randomness)
+    {
+        // unlike random_time_until_next_event this is centered around the
+        // average so that the average doesn't change
+        if constexpr (JitterPercent == 0)
+        {
+            static_cast<void>(randomness);
+            return average_time_between_events;
+        }
+        else
+        {
+            uint32_t jitter = static_cast<uint32_t>(static_cast<uint64_t>(average_time_between_events) * JitterPercent / 100);
+            return average_time_between_events - jitter / 2 + std::uniform_int_distribution<uint32_t>(0, jitter)(randomness);
+        }
+    }
+
+public:
+
+    // the biggest delay is average * 3 / 2 so this makes sure that every
+    // event is always less than 2^31 units in the future. that's what makes
+    // it safe to compare times on a timeline that wraps around
+    static constexpr uint32_t max_average_time = 1u << 30;
+
+    EventScheduler()
+    {
+    }
+
+    // returns the index of the event. the first time it fires will be in
+    // average_time_between_events. call initialize_randomness after adding
+    // all events to randomize that.
+    size_t add_event(uint32_t average_time_between_events)
+    {
+        assert(average_time_between_events >= 1);
+        assert(average_time_between_events <= max_average_time);
+        size_t index = events.size();
+        events.push_back(Event{ current_time + average_time_between_events, average_time_between_events, index });
+        std::push_heap(events.begin(), events.end(), CompareByNextTime{current_time});
+        return index;
+    }
+
+    size_t num_events() const
+    {
+        return events.size();
+    }
+
+    // picks a random time for the first firing of each event so that events
+    // with the same frequency don't all fire at once
+    template<typename Random>
+    void initialize_randomness(Random & randomness)
+    {
+        for (Event & e : events)
+        {
+            e.next_event_time = current_time + std::uniform_int_distribution<uint32_t>(1, e.average_time_between_events)(randomness);
+        }
+        std::make_heap(events.begin(), events.end(), CompareByNextTime{current_time});
+    }
+
+    // how long you can wait before anything fires. useful for sleeping
+    uint32_t time_until_next_event() const
+    {
+        assert(!events.empty());
+        return events.front().next_event_time - current_time;
+    }
+
+    // advances the time and writes the index of every event that fired into
+    // out, in the order in which they fired. an event can fire several times
+    // if elapsed is long enough. if nothing is due this only looks at the top
+    // of the heap
+    template<typename Random, typename OutputIt>
+    OutputIt poll(Random & randomness, uint32_t elapsed, OutputIt out)
+    {
+        // events can be rescheduled up to max_average_time * 3 / 2 past the
+        // end of the step. this keeps that within 2^32 of current_time
+        constexpr uint32_t max_step = 1u << 31;
+        if (elapsed > max_step)
+        {
+            out = poll(randomness, max_step, out);
+            elapsed -= max_step;
+        }
+        if (events.empty() || events.front().next_event_time - current_time > elapsed)
+        {
+            current_time += elapsed;
+            return out;
+        }
+        CompareByNextTime compare{current_time};
+        do
+        {
+            Event & due = events.front();
+            *out = due.original_index;
+            ++out;
+            due.next_event_time += centered_time_until_next_event(due.average_time_between_events, randomness);
+            heap_top_updated(events.begin(), events.end(), compare);
+        }
+        while (events.front().next_event_time - current_time <= elapsed);
+        current_time += elapsed;
+        return out;
+    }
+};
+
 }
 